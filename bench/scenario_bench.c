@@ -0,0 +1,139 @@
+// scenario_bench.c -- write a large binary and CSV scenario, load each with
+// a large capacity, check the particles and the saveScenarioBinary round
+// trip, and time the loads. Built and run by `make bench`;
+// usage: scenario_bench [particles]
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/scenario.h"
+
+#define SCEN_DEFAULT_COUNT 10000000
+#define SCEN_GRID_W 4096
+#define SCEN_GRID_H 4096
+
+static double now_sec(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Deterministic start; energies stay small so the total fits an int */
+static void make_particles(Particle* p, int n) {
+  unsigned int r = 12345u;
+  for (int i = 0; i < n; ++i) {
+    r = r * 1103515245u + 12345u;
+    p[i].x = (int)((r >> 8) % SCEN_GRID_W);
+    r = r * 1103515245u + 12345u;
+    p[i].y = (int)((r >> 8) % SCEN_GRID_H);
+    p[i].energy = 1 + i % 5;
+    p[i].brightness = (p[i].energy >= 4) ? 2 : 1;
+    p[i].alive = 1;
+  }
+}
+
+/* Loaded particles must equal the originals, and the rest be dead */
+static int same_particles(const Particle* want, const Particle* got, int n,
+                          int capacity, const char* what) {
+  for (int i = 0; i < n; ++i) {
+    if (memcmp(&want[i], &got[i], sizeof(Particle)) != 0) {
+      fprintf(stderr, "FAIL: %s particle %d differs\n", what, i);
+      return 0;
+    }
+  }
+  for (int i = n; i < capacity; ++i) {
+    if (got[i].alive) {
+      fprintf(stderr, "FAIL: %s left particle %d alive\n", what, i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int write_csv(const char* path, const Particle* p, int n) {
+  FILE* fp = fopen(path, "w");
+  if (!fp) return 0;
+  fprintf(fp, "x,y,energy\n# generated by scenario_bench\n");
+  for (int i = 0; i < n; ++i)
+    fprintf(fp, "%d,%d,%d\n", p[i].x, p[i].y, p[i].energy);
+  return fclose(fp) == 0;
+}
+
+static int same_file(const char* a, const char* b) {
+  FILE* fa = fopen(a, "rb");
+  FILE* fb = fopen(b, "rb");
+  int same = fa && fb;
+  while (same) {
+    int ca = getc(fa), cb = getc(fb);
+    if (ca != cb) same = 0;
+    if (ca == EOF) break;
+  }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return same;
+}
+
+int main(int argc, char** argv) {
+  int n = (argc > 1) ? atoi(argv[1]) : SCEN_DEFAULT_COUNT;
+  if (n <= 0) n = SCEN_DEFAULT_COUNT;
+  int capacity = n + 1000; /* slack so kill_rest is checked too */
+
+  char dir[] = "/tmp/nebulasim-scen-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char bin[64], bin2[64], csv[64];
+  snprintf(bin, sizeof(bin), "%s/start.bin", dir);
+  snprintf(bin2, sizeof(bin2), "%s/again.bin", dir);
+  snprintf(csv, sizeof(csv), "%s/start.csv", dir);
+
+  Particle* want = malloc(sizeof(Particle) * (size_t)n);
+  Particle* got = malloc(sizeof(Particle) * (size_t)capacity);
+  if (!want || !got) {
+    fprintf(stderr, "Out of memory for %d particles.\n", n);
+    return 1;
+  }
+  make_particles(want, n);
+  if (!saveScenarioBinary(bin, want, n) || !write_csv(csv, want, n)) {
+    fprintf(stderr, "FAIL: could not write scenarios to %s\n", dir);
+    return 1;
+  }
+
+  int ok = 1;
+  double t0 = now_sec();
+  int loaded =
+      loadScenarioBinary(bin, got, capacity, SCEN_GRID_W, SCEN_GRID_H);
+  double t_bin = now_sec() - t0;
+  ok = ok && loaded == n && same_particles(want, got, n, capacity, "binary");
+
+  /* round trip: saving what was loaded reproduces the file byte for byte */
+  ok = ok && saveScenarioBinary(bin2, got, capacity) && same_file(bin, bin2);
+  if (!ok) fprintf(stderr, "FAIL: binary load / round trip\n");
+
+  memset(got, 0xff, sizeof(Particle) * (size_t)capacity);
+  t0 = now_sec();
+  loaded = loadScenarioText(csv, got, capacity, SCEN_GRID_W, SCEN_GRID_H);
+  double t_csv = now_sec() - t0;
+  if (loaded != n || !same_particles(want, got, n, capacity, "csv")) {
+    fprintf(stderr, "FAIL: csv load returned %d of %d\n", loaded, n);
+    ok = 0;
+  }
+
+  remove(bin);
+  remove(bin2);
+  remove(csv);
+  rmdir(dir);
+  free(want);
+  free(got);
+
+  fprintf(stderr, "scenario load: %d particles, %dx%d grid\n", n, SCEN_GRID_W,
+          SCEN_GRID_H);
+  fprintf(stderr, "  binary (mmap)    %.3f s\n", t_bin);
+  fprintf(stderr, "  csv (chunked)    %.3f s\n", t_csv);
+  fprintf(stderr, ok ? "OK\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+// server_check.c -- end-to-end check of daemon mode: starts NebulaSim
+// --serve on a temporary socket and drives the protocol from server.h.
+// Built and run by `make check`; usage: server_check [path/to/NebulaSim]
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/server.h"
+
+#define CHECK_WORKERS "1" /* one worker so a stalled client would show */
+#define CHECK_STALLED 4   /* clients that never read their replies */
+#define FRAME_MAX (80 * 50)
+
+static int failures = 0;
+
+#define EXPECT(cond, what)                  \
+  do {                                      \
+    if (!(cond)) {                          \
+      printf("  FAIL: %s\n", what);         \
+      failures++;                           \
+    }                                       \
+  } while (0)
+
+static double now_sec(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void sleep_ms(long ms) {
+  struct timespec t = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&t, NULL);
+}
+
+static int connect_to(const char* path) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int io_all(int fd, void* buf, size_t len, int sending) {
+  unsigned char* b = buf;
+  while (len > 0) {
+    ssize_t n = sending ? send(fd, b, len, MSG_NOSIGNAL) : recv(fd, b, len, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return 0;
+    b += n;
+    len -= (size_t)n;
+  }
+  return 1;
+}
+
+/* Send one request and read its reply. Returns the reply status, or -1 if
+   the connection failed; *len is set to the payload size. */
+static int call(int fd, uint32_t op, uint32_t session, uint32_t a0,
+                uint32_t a1, uint32_t a2, uint32_t a3, void* payload,
+                uint32_t* len) {
+  ServerRequest rq = {op, session, {a0, a1, a2, a3}};
+  ServerReplyHeader hdr;
+  if (!io_all(fd, &rq, sizeof(rq), 1) || !io_all(fd, &hdr, sizeof(hdr), 0))
+    return -1;
+  if (hdr.length > FRAME_MAX) return -1;
+  if (hdr.length && !io_all(fd, payload, hdr.length, 0)) return -1;
+  if (len) *len = hdr.length;
+  return (int)hdr.status;
+}
+
+static uint32_t create(int fd, uint32_t w, uint32_t h, uint32_t n,
+                       uint32_t seed) {
+  uint32_t id = 0, len = 0;
+  if (call(fd, SRV_OP_CREATE, 0, w, h, n, seed, &id, &len) != SRV_OK ||
+      len != sizeof(id))
+    return 0;
+  return id;
+}
+
+/* CREATE -> STEP -> FRAME -> STATS -> DESTROY on one connection */
+static void check_lifecycle(int fd) {
+  printf("lifecycle\n");
+  uint32_t id = create(fd, 40, 20, 100, 7);
+  EXPECT(id != 0, "CREATE returns a session id");
+
+  ServerStats st;
+  uint32_t len = 0;
+  EXPECT(call(fd, SRV_OP_STEP, id, 5, 0, 0, 0, &st, &len) == SRV_OK &&
+             len == sizeof(st),
+         "STEP replies with stats");
+  EXPECT(st.step == 5 && st.grid_w == 40 && st.grid_h == 20,
+         "STEP counts steps and keeps the grid");
+  EXPECT(st.alive >= 1 && st.alive <= 100, "STEP leaves 1..100 alive");
+
+  char frame[FRAME_MAX];
+  EXPECT(call(fd, SRV_OP_FRAME, id, 0, 0, 0, 0, frame, &len) == SRV_OK &&
+             len == 40 * 20,
+         "FRAME returns grid_w * grid_h cells");
+  uint32_t lit = 0, odd = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    if (frame[i] == '*' || frame[i] == 'O')
+      lit++;
+    else if (frame[i] != '.')
+      odd++;
+  }
+  EXPECT(odd == 0 && lit >= 1 && lit <= st.alive,
+         "FRAME shows the alive particles as * or O on .");
+
+  ServerStats again;
+  EXPECT(call(fd, SRV_OP_STATS, id, 0, 0, 0, 0, &again, &len) == SRV_OK &&
+             memcmp(&st, &again, sizeof(st)) == 0,
+         "STATS matches the last STEP");
+
+  EXPECT(call(fd, SRV_OP_DESTROY, id, 0, 0, 0, 0, NULL, &len) == SRV_OK &&
+             len == 0,
+         "DESTROY succeeds with no payload");
+  EXPECT(call(fd, SRV_OP_STATS, id, 0, 0, 0, 0, &st, &len) ==
+             SRV_ERR_NO_SESSION,
+         "destroyed id is unknown");
+}
+
+/* Same seed on two sessions (and two connections) gives the same frames */
+static void check_same_seed(int fd, int fd2) {
+  printf("same seed\n");
+  uint32_t a = create(fd, 80, 50, 200, 12345);
+  uint32_t b = create(fd2, 80, 50, 200, 12345);
+  EXPECT(a && b && a != b, "two sessions get distinct ids");
+  char fa[FRAME_MAX], fb[FRAME_MAX];
+  uint32_t la = 0, lb = 0;
+  ServerStats st;
+  for (int round = 0; round < 5; ++round) {
+    call(fd, SRV_OP_FRAME, a, 0, 0, 0, 0, fa, &la);
+    call(fd2, SRV_OP_FRAME, b, 0, 0, 0, 0, fb, &lb);
+    if (la != lb || la != 80 * 50 || memcmp(fa, fb, la) != 0) {
+      printf("  FAIL: frames differ after %d steps\n", round * 3);
+      failures++;
+      break;
+    }
+    call(fd, SRV_OP_STEP, a, 3, 0, 0, 0, &st, NULL);
+    call(fd2, SRV_OP_STEP, b, 3, 0, 0, 0, &st, NULL);
+  }
+  call(fd, SRV_OP_DESTROY, a, 0, 0, 0, 0, NULL, NULL);
+  call(fd2, SRV_OP_DESTROY, b, 0, 0, 0, 0, NULL, NULL);
+}
+
+/* Ids that were never issued, or whose slot has been reused, match nothing */
+static void check_stale_ids(int fd) {
+  printf("stale ids\n");
+  ServerStats st;
+  EXPECT(call(fd, SRV_OP_STATS, 0, 0, 0, 0, 0, &st, NULL) ==
+             SRV_ERR_NO_SESSION,
+         "id 0 is unknown");
+  EXPECT(call(fd, SRV_OP_STEP, 999999u, 1, 0, 0, 0, &st, NULL) ==
+             SRV_ERR_NO_SESSION,
+         "never-issued id is unknown");
+  uint32_t old = create(fd, 10, 10, 5, 1);
+  call(fd, SRV_OP_DESTROY, old, 0, 0, 0, 0, NULL, NULL);
+  uint32_t fresh = create(fd, 10, 10, 5, 1);
+  EXPECT(fresh != 0 && fresh != old, "new session gets a new id");
+  EXPECT(call(fd, SRV_OP_FRAME, old, 0, 0, 0, 0, NULL, NULL) ==
+             SRV_ERR_NO_SESSION,
+         "old id does not reach the reused slot");
+  EXPECT(call(fd, SRV_OP_DESTROY, old, 0, 0, 0, 0, NULL, NULL) ==
+             SRV_ERR_NO_SESSION,
+         "old id cannot destroy the new session");
+  EXPECT(call(fd, SRV_OP_STATS, fresh, 0, 0, 0, 0, &st, NULL) == SRV_OK,
+         "new session still answers");
+  call(fd, SRV_OP_DESTROY, fresh, 0, 0, 0, 0, NULL, NULL);
+}
+
+static void check_bad_requests(int fd) {
+  printf("bad requests\n");
+  uint32_t id = create(fd, 10, 10, 5, 1);
+  ServerStats st;
+  EXPECT(call(fd, 0, id, 0, 0, 0, 0, &st, NULL) == SRV_ERR_BAD_OP,
+         "op 0 is rejected");
+  EXPECT(call(fd, 99, id, 0, 0, 0, 0, &st, NULL) == SRV_ERR_BAD_OP,
+         "op 99 is rejected");
+  EXPECT(call(fd, SRV_OP_CREATE, 0, 4, 10, 5, 1, &st, NULL) ==
+             SRV_ERR_BAD_ARGS,
+         "grid width below 5 is rejected");
+  EXPECT(call(fd, SRV_OP_CREATE, 0, 10, 51, 5, 1, &st, NULL) ==
+             SRV_ERR_BAD_ARGS,
+         "grid height above 50 is rejected");
+  EXPECT(call(fd, SRV_OP_CREATE, 0, 10, 10, 0, 1, &st, NULL) ==
+             SRV_ERR_BAD_ARGS,
+         "zero particles is rejected");
+  EXPECT(call(fd, SRV_OP_CREATE, 0, 0xffffffffu, 10, 5, 1, &st, NULL) ==
+             SRV_ERR_BAD_ARGS,
+         "negative-looking width is rejected");
+  EXPECT(call(fd, SRV_OP_STEP, id, SERVER_MAX_STEPS_PER_REQ + 1, 0, 0, 0, &st,
+              NULL) == SRV_ERR_BAD_ARGS,
+         "too many steps in one request is rejected");
+  EXPECT(call(fd, SRV_OP_STATS, id, 0, 0, 0, 0, &st, NULL) == SRV_OK &&
+             st.step == 0,
+         "session is untouched by rejected requests");
+  call(fd, SRV_OP_DESTROY, id, 0, 0, 0, 0, NULL, NULL);
+}
+
+/* Clients that queue frame requests and never read the replies must not
+   hold up anyone else, even with a single worker */
+static void check_stalled_clients(const char* path, int fd) {
+  printf("stalled clients\n");
+  int stalled[CHECK_STALLED];
+  for (int k = 0; k < CHECK_STALLED; ++k) {
+    stalled[k] = connect_to(path);
+    uint32_t id = create(stalled[k], 80, 50, 200, (uint32_t)k);
+    ServerRequest rq = {SRV_OP_FRAME, id, {0, 0, 0, 0}};
+    fcntl(stalled[k], F_SETFL, O_NONBLOCK);
+    for (int i = 0; i < 1000; ++i) {
+      if (send(stalled[k], &rq, sizeof(rq), MSG_NOSIGNAL) != sizeof(rq)) break;
+    }
+  }
+  sleep_ms(300); /* let their socket buffers fill up */
+  double t0 = now_sec();
+  uint32_t id = create(fd, 20, 20, 50, 3);
+  ServerStats st;
+  int ok = id && call(fd, SRV_OP_STEP, id, 10, 0, 0, 0, &st, NULL) == SRV_OK;
+  double took = now_sec() - t0;
+  EXPECT(ok && took < 1.0, "other clients are served while some stall");
+  printf("  create + step took %.1f ms\n", took * 1000);
+  call(fd, SRV_OP_DESTROY, id, 0, 0, 0, 0, NULL, NULL);
+  for (int k = 0; k < CHECK_STALLED; ++k) close(stalled[k]);
+}
+
+/* SIGINT stops the daemon with status 0 and removes its socket */
+static void check_shutdown(pid_t pid, const char* path) {
+  printf("shutdown\n");
+  kill(pid, SIGINT);
+  int status = 0;
+  double t0 = now_sec();
+  pid_t done = 0;
+  while ((done = waitpid(pid, &status, WNOHANG)) == 0 && now_sec() - t0 < 5)
+    sleep_ms(10);
+  if (done == 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+  }
+  EXPECT(done == pid, "daemon exits within 5 s of SIGINT");
+  EXPECT(done == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+         "daemon exits with status 0");
+  struct stat sb;
+  EXPECT(stat(path, &sb) < 0 && errno == ENOENT, "socket path is removed");
+}
+
+static pid_t start_daemon(const char* exe, const char* path) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) dup2(null, STDOUT_FILENO);
+    execl(exe, exe, "--serve", path, CHECK_WORKERS, (char*)NULL);
+    perror(exe);
+    _exit(127);
+  }
+  return pid;
+}
+
+int main(int argc, char** argv) {
+  const char* exe = (argc > 1) ? argv[1] : "./NebulaSim";
+  char dir[] = "/tmp/nebulasim-srv-XXXXXX";
+  if (!mkdtemp(dir)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "%s/check.sock", dir);
+
+  pid_t pid = start_daemon(exe, path);
+  if (pid < 0) {
+    perror("fork");
+    return 1;
+  }
+  int fd = -1;
+  for (int i = 0; i < 500 && fd < 0; ++i) {
+    fd = connect_to(path);
+    if (fd < 0) sleep_ms(10);
+  }
+  int fd2 = connect_to(path);
+  if (fd < 0 || fd2 < 0) {
+    printf("server_check: daemon did not start on %s\n", path);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    rmdir(dir);
+    return 1;
+  }
+
+  printf("server_check: %s --serve %s\n", exe, path);
+  check_lifecycle(fd);
+  check_same_seed(fd, fd2);
+  check_stale_ids(fd);
+  check_bad_requests(fd);
+  check_stalled_clients(path, fd);
+  close(fd);
+  close(fd2);
+  check_shutdown(pid, path);
+  rmdir(dir);
+
+  if (failures) {
+    printf("FAIL (%d)\n", failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,197 @@
+// step_bench.c -- time the steady-state step loop and check that it never
+// touches the heap, for the menu-sized run and for a large particle store in
+// a huge-page arena. Build and run with `make bench`.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/arena.h"
+#include "../src/nebula.h"
+
+#define BENCH_GRID_W 80
+#define BENCH_GRID_H 50
+#define BENCH_WARMUP 10
+#define BENCH_STEPS 2000
+
+/* Large store: big enough that the arena takes the huge-page path */
+#define LARGE_COUNT 1000000
+#define LARGE_GRID 1024
+#define LARGE_STEPS 20
+
+/* Count every heap call in the process (glibc only: forwards to the
+   __libc_* entry points so stdio's own allocations are seen too). */
+static long heap_calls = 0;
+
+#ifdef __GLIBC__
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+extern void __libc_free(void*);
+
+void* malloc(size_t n) {
+  heap_calls++;
+  return __libc_malloc(n);
+}
+void* calloc(size_t n, size_t m) {
+  heap_calls++;
+  return __libc_calloc(n, m);
+}
+void* realloc(void* p, size_t n) {
+  heap_calls++;
+  return __libc_realloc(p, n);
+}
+void free(void* p) {
+  if (p) heap_calls++;
+  __libc_free(p);
+}
+#define HEAP_COUNTED 1
+#else
+#define HEAP_COUNTED 0
+#endif
+
+static double now_sec(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* One iteration of the batch loop in main.c: raster, frame file, step */
+static void run_step(Particle* p, Arena* arena, size_t mark, int s) {
+  arena_reset(arena, mark);
+  displayGrid(p, MAX_PARTICLES, BENCH_GRID_W, BENCH_GRID_H, arena);
+  saveToFile(p, MAX_PARTICLES, s, BENCH_GRID_W, BENCH_GRID_H, arena);
+  stepSimulation(p, MAX_PARTICLES, BENCH_GRID_W, BENCH_GRID_H, NULL, arena);
+}
+
+static const char* huge_name(int huge) {
+  switch (huge) {
+    case ARENA_HUGE_EXPLICIT:
+      return "MAP_HUGETLB";
+    case ARENA_HUGE_ADVISED:
+      return "MADV_HUGEPAGE";
+    default:
+      return "none";
+  }
+}
+
+/* Step a large particle store held in a huge-page arena (rasters and
+   collision buckets come from the same arena). Returns 1 if it passed. */
+static int bench_large_store(void) {
+  size_t store = sizeof(Particle) * LARGE_COUNT;
+  size_t scratch = sizeof(int) * LARGE_GRID * LARGE_GRID +
+                   (size_t)LARGE_GRID * LARGE_GRID + 4096;
+  Arena arena;
+  if (!arena_init(&arena, store + scratch)) {
+    fprintf(stderr, "FAIL: could not reserve the large arena\n");
+    return 0;
+  }
+  int ok = 1;
+  fprintf(stderr, "large store: %d particles, %dx%d grid, %zu MiB arena\n",
+          LARGE_COUNT, LARGE_GRID, LARGE_GRID, arena.size >> 20);
+  fprintf(stderr, "  backing: %s, huge pages: %s\n",
+          arena.mapped ? "mmap" : "malloc", huge_name(arena.huge));
+  if (arena.size % ARENA_HUGE_PAGE != 0 || !arena.mapped) {
+    fprintf(stderr, "FAIL: large arena not mapped in whole huge pages\n");
+    ok = 0;
+  }
+
+  Particle* p = arena_alloc(&arena, store);
+  size_t mark = arena_mark(&arena);
+  unsigned int seed = 42;
+  for (int i = 0; p && i < LARGE_COUNT; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    p[i].x = (int)((seed >> 8) % LARGE_GRID);
+    seed = seed * 1103515245u + 12345u;
+    p[i].y = (int)((seed >> 8) % LARGE_GRID);
+    p[i].energy = 1 + i % 5;
+    p[i].brightness = 1;
+    p[i].alive = 1;
+  }
+
+  long before = heap_calls;
+  double t0 = now_sec();
+  for (int s = 0; p && s < LARGE_STEPS; ++s) {
+    arena_reset(&arena, mark);
+    char* raster = arena_alloc(&arena, (size_t)LARGE_GRID * LARGE_GRID);
+    if (!raster) break;
+    renderGrid(p, LARGE_COUNT, LARGE_GRID, LARGE_GRID, raster);
+    stepSimulation(p, LARGE_COUNT, LARGE_GRID, LARGE_GRID, &seed, &arena);
+  }
+  double elapsed = now_sec() - t0;
+  long allocs = heap_calls - before;
+
+  /* the buckets must have fit, or the step silently went pairwise */
+  if (!p || arena.used < mark + sizeof(int) * LARGE_GRID * LARGE_GRID) {
+    fprintf(stderr, "FAIL: large store or buckets did not fit the arena\n");
+    ok = 0;
+  }
+  fprintf(stderr, "  %.2f ms/step\n", elapsed * 1e3 / LARGE_STEPS);
+  if (HEAP_COUNTED) {
+    fprintf(stderr, "  heap allocations in steady state: %ld\n", allocs);
+    if (allocs != 0) {
+      fprintf(stderr, "FAIL: large step loop allocated from the heap\n");
+      ok = 0;
+    }
+  }
+  arena_release(&arena);
+  return ok;
+}
+
+int main(void) {
+  /* frames go to a throwaway steps/ folder, the display to /dev/null */
+  char dir[] = "/tmp/nebulasim-bench-XXXXXX";
+  if (!mkdtemp(dir) || chdir(dir) != 0 || mkdir("steps", 0755) != 0) {
+    perror("bench setup");
+    return 1;
+  }
+  if (!freopen("/dev/null", "w", stdout)) return 1;
+
+  Arena arena;
+  if (!arena_init(&arena, sizeof(Particle) * MAX_PARTICLES + 64 * 1024))
+    return 1;
+  Particle* p = arena_alloc(&arena, sizeof(Particle) * MAX_PARTICLES);
+  size_t mark = arena_mark(&arena);
+
+  srand(1234);
+  initializeParticles(p, MAX_PARTICLES, BENCH_GRID_W, BENCH_GRID_H);
+  for (int s = 1; s <= BENCH_WARMUP; ++s) run_step(p, &arena, mark, s);
+
+  long before = heap_calls;
+  double t0 = now_sec();
+  for (int s = 1; s <= BENCH_STEPS; ++s)
+    run_step(p, &arena, mark, BENCH_WARMUP + s);
+  double elapsed = now_sec() - t0;
+  long allocs = heap_calls - before;
+
+  /* clean up the frames */
+  for (int s = 1; s <= BENCH_WARMUP + BENCH_STEPS; ++s) {
+    char name[64];
+    snprintf(name, sizeof(name), "steps/step%04d.txt", s);
+    remove(name);
+  }
+  rmdir("steps");
+  if (chdir("/") == 0) rmdir(dir);
+  arena_release(&arena);
+
+  fprintf(stderr, "step loop: %d steps, %dx%d grid, %d particles\n",
+          BENCH_STEPS, BENCH_GRID_W, BENCH_GRID_H, MAX_PARTICLES);
+  fprintf(stderr, "  %.2f us/step\n", elapsed * 1e6 / BENCH_STEPS);
+  int ok = 1;
+  if (!HEAP_COUNTED) {
+    fprintf(stderr, "  heap allocations: not counted on this libc\n");
+  } else {
+    fprintf(stderr, "  heap allocations in steady state: %ld\n", allocs);
+    if (allocs != 0) {
+      fprintf(stderr, "FAIL: step loop allocated from the heap\n");
+      ok = 0;
+    }
+  }
+
+  if (!bench_large_store()) ok = 0;
+  fprintf(stderr, ok ? "OK\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+// step_diff.c -- differential check of optimised step engines against the
+// reference loops (moveParticles + handleCollisions + updateBrightness).
+// Build and run with `make check`; usage: step_diff [cases] [seed]
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/arena.h"
+#include "../src/nebula.h"
+
+#define DIFF_DEFAULT_CASES 100
+#define DIFF_STEPS 30
+#define DIFF_MAX_COUNT 2000
+#define DIFF_SCRATCH (64 * 1024)
+
+/* An engine advances p by exactly one step, drawing randomness from rand()
+   in the same order as the reference. scratch is reset before each call. */
+typedef void (*StepFn)(Particle* p, int count, int grid_w, int grid_h,
+                       Arena* scratch);
+
+typedef struct {
+  const char* name;
+  StepFn step;
+  double seconds;  // total time over all cases
+  int failed;
+} Engine;
+
+/* The original simple loops: the results every engine must reproduce */
+static void reference_step(Particle* p, int count, int grid_w, int grid_h,
+                           Arena* scratch) {
+  (void)scratch;
+  moveParticles(p, count, grid_w, grid_h);
+  handleCollisions(p, count, grid_w, grid_h);
+  updateBrightness(p, count);
+}
+
+static void bucketed_step(Particle* p, int count, int grid_w, int grid_h,
+                          Arena* scratch) {
+  stepSimulation(p, count, grid_w, grid_h, NULL, scratch);
+}
+
+/* Register new engines here */
+static Engine engines[] = {
+    {"bucketed", bucketed_step, 0.0, 0},
+};
+#define NUM_ENGINES ((int)(sizeof(engines) / sizeof(engines[0])))
+
+typedef struct {
+  unsigned int seed;
+  int grid_w, grid_h, count;
+} DiffCase;
+
+static double now_sec(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* Random start that also covers dead particles, zero energy and crowded
+   cells, which initializeParticles avoids */
+static void make_start(const DiffCase* c, Particle* p) {
+  srand(c->seed);
+  for (int i = 0; i < c->count; ++i) {
+    p[i].x = rand() % c->grid_w;
+    p[i].y = rand() % c->grid_h;
+    p[i].energy = rand() % 7;
+    p[i].brightness = (p[i].energy >= 4) ? 2 : 1;
+    p[i].alive = (rand() % 20) != 0;
+  }
+}
+
+/* Each step reseeds rand() so two runs can be compared in lockstep */
+static void seed_step(const DiffCase* c, int step) {
+  srand(c->seed * 2654435761u + (unsigned int)step);
+}
+
+/* Dead particles only have to agree on `alive`; they never come back */
+static int same_particle(const Particle* a, const Particle* b) {
+  if (a->alive != b->alive) return 0;
+  if (!a->alive) return 1;
+  return a->x == b->x && a->y == b->y && a->energy == b->energy &&
+         a->brightness == b->brightness;
+}
+
+static void print_particle(const char* label, const Particle* q) {
+  printf("    %-9s x=%d y=%d energy=%d brightness=%d alive=%d\n", label, q->x,
+         q->y, q->energy, q->brightness, q->alive);
+}
+
+/* Run reference and engine side by side; report the first divergence */
+static int check_engine(Engine* e, const DiffCase* c, int case_no,
+                        Particle* ref, Particle* got, Arena* scratch) {
+  make_start(c, ref);
+  memcpy(got, ref, sizeof(Particle) * (size_t)c->count);
+  for (int s = 1; s <= DIFF_STEPS; ++s) {
+    seed_step(c, s);
+    reference_step(ref, c->count, c->grid_w, c->grid_h, NULL);
+    seed_step(c, s);
+    arena_reset(scratch, 0);
+    e->step(got, c->count, c->grid_w, c->grid_h, scratch);
+    for (int i = 0; i < c->count; ++i) {
+      if (same_particle(&ref[i], &got[i])) continue;
+      printf("  %s: DIVERGED in case %d (seed %u, grid %dx%d, %d particles)"
+             "\n    first at step %d, particle %d\n",
+             e->name, case_no, c->seed, c->grid_w, c->grid_h, c->count, s, i);
+      print_particle("reference", &ref[i]);
+      print_particle(e->name, &got[i]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* handleCollisionsBucketed must also match handleCollisions for callers
+   outside the step loop: particles off the grid (no bucket) and no scratch
+   arena both have to fall back to the pairwise loop */
+static int check_collision_fallbacks(Particle* ref, Particle* got,
+                                     Arena* scratch) {
+  const int w = 8, h = 6, n = 400;
+  for (int trial = 0; trial < 2; ++trial) {
+    srand(99u + (unsigned int)trial);
+    for (int i = 0; i < n; ++i) {
+      ref[i].x = rand() % (w + 4) - 2; /* -2..w+1, some off the grid */
+      ref[i].y = rand() % (h + 4) - 2;
+      ref[i].energy = rand() % 7;
+      ref[i].brightness = 1;
+      ref[i].alive = 1;
+    }
+    memcpy(got, ref, sizeof(Particle) * (size_t)n);
+    handleCollisions(ref, n, w, h);
+    arena_reset(scratch, 0);
+    handleCollisionsBucketed(got, n, w, h, trial == 0 ? scratch : NULL);
+    for (int i = 0; i < n; ++i) {
+      if (same_particle(&ref[i], &got[i])) continue;
+      printf("  collisions: %s fallback differs at particle %d\n",
+             trial == 0 ? "off-grid" : "no-scratch", i);
+      print_particle("reference", &ref[i]);
+      print_particle("bucketed", &got[i]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Time DIFF_STEPS steps of fn from the case's start state */
+static double time_run(StepFn fn, const DiffCase* c, Particle* p,
+                       Arena* scratch) {
+  make_start(c, p);
+  double t0 = now_sec();
+  for (int s = 1; s <= DIFF_STEPS; ++s) {
+    seed_step(c, s);
+    arena_reset(scratch, 0);
+    fn(p, c->count, c->grid_w, c->grid_h, scratch);
+  }
+  return now_sec() - t0;
+}
+
+int main(int argc, char** argv) {
+  int cases = (argc > 1) ? atoi(argv[1]) : DIFF_DEFAULT_CASES;
+  unsigned int base = (argc > 2) ? (unsigned int)strtoul(argv[2], NULL, 10)
+                                 : (unsigned int)time(NULL);
+  if (cases <= 0) cases = DIFF_DEFAULT_CASES;
+
+  Particle* ref = malloc(sizeof(Particle) * DIFF_MAX_COUNT);
+  Particle* got = malloc(sizeof(Particle) * DIFF_MAX_COUNT);
+  Arena scratch;
+  if (!ref || !got || !arena_init(&scratch, DIFF_SCRATCH)) {
+    printf("Out of memory.\n");
+    return 1;
+  }
+
+  printf("step_diff: %d cases x %d steps, base seed %u\n", cases, DIFF_STEPS,
+         base);
+  int failures = 0;
+  if (!check_collision_fallbacks(ref, got, &scratch)) failures++;
+  double ref_seconds = 0.0;
+  for (int k = 0; k < cases; ++k) {
+    /* case parameters come from their own stream, separate from the
+       per-step seeds */
+    unsigned int r = base + (unsigned int)k * 7919u;
+    DiffCase c;
+    c.seed = r;
+    srand(r);
+    c.grid_w = 5 + rand() % 76; /* same limits as the menu: 5..80 */
+    c.grid_h = 5 + rand() % 46; /* 5..50 */
+    c.count = 1 + rand() % DIFF_MAX_COUNT;
+
+    ref_seconds += time_run(reference_step, &c, ref, &scratch);
+    for (int e = 0; e < NUM_ENGINES; ++e) {
+      if (engines[e].failed) continue;
+      if (!check_engine(&engines[e], &c, k, ref, got, &scratch)) {
+        engines[e].failed = 1;
+        continue;
+      }
+      engines[e].seconds += time_run(engines[e].step, &c, got, &scratch);
+    }
+  }
+
+  printf("  %-10s %9.3f s\n", "reference", ref_seconds);
+  for (int e = 0; e < NUM_ENGINES; ++e) {
+    if (engines[e].failed) {
+      printf("  %-10s FAILED (see above)\n", engines[e].name);
+      failures++;
+    } else {
+      printf("  %-10s %9.3f s  %6.2fx  matches reference\n", engines[e].name,
+             engines[e].seconds,
+             engines[e].seconds > 0 ? ref_seconds / engines[e].seconds : 0.0);
+    }
+  }
+
+  arena_release(&scratch);
+  free(ref);
+  free(got);
+  return failures ? 1 : 0;
+}
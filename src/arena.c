@@ -0,0 +1,80 @@
+// arena.c -- run-scoped bump allocator (see arena.h)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, MAP_HUGETLB, madvise */
+#include "arena.h"
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define ARENA_ALIGN 16
+
+/* Try explicit huge pages, then transparent huge pages, then plain pages.
+   *huge reports which one took effect. */
+static void* map_region(size_t size, int* huge) {
+  *huge = ARENA_HUGE_NONE;
+#if !defined(_WIN32) && defined(MAP_ANONYMOUS)
+  void* m;
+#ifdef MAP_HUGETLB
+  if (size >= ARENA_HUGE_PAGE && size % ARENA_HUGE_PAGE == 0) {
+    m = mmap(NULL, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (m != MAP_FAILED) {
+      *huge = ARENA_HUGE_EXPLICIT;
+      return m;
+    }
+  }
+#endif
+  m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0);
+  if (m == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+  if (size >= ARENA_HUGE_PAGE && madvise(m, size, MADV_HUGEPAGE) == 0)
+    *huge = ARENA_HUGE_ADVISED;
+#endif
+  return m;
+#else
+  (void)size;
+  return NULL;
+#endif
+}
+
+int arena_init(Arena* a, size_t size) {
+  a->used = 0;
+  a->mapped = 0;
+  /* round large regions up to whole huge pages */
+  if (size >= ARENA_HUGE_PAGE)
+    size = (size + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+  a->size = size;
+  a->base = map_region(size, &a->huge);
+  if (a->base) {
+    a->mapped = 1;
+    return 1;
+  }
+  a->base = malloc(size);
+  return a->base != NULL;
+}
+
+void* arena_alloc(Arena* a, size_t n) {
+  if (!a || !a->base) return NULL;
+  size_t start = (a->used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (start > a->size || n > a->size - start) return NULL;
+  a->used = start + n;
+  return a->base + start;
+}
+
+size_t arena_mark(const Arena* a) { return a->used; }
+
+void arena_reset(Arena* a, size_t mark) {
+  if (mark <= a->used) a->used = mark;
+}
+
+void arena_release(Arena* a) {
+#ifndef _WIN32
+  if (a->mapped) munmap(a->base, a->size);
+#endif
+  if (!a->mapped) free(a->base);
+  a->base = NULL;
+  a->size = a->used = 0;
+}
@@ -0,0 +1,43 @@
+// arena.h -- run-scoped bump allocator for particles and per-step scratch
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Regions at least this big try to use huge pages (Linux) */
+#define ARENA_HUGE_PAGE (2u << 20)
+
+/* Memory is reserved once per run. Long-lived data (the particle array) is
+   allocated first; take a mark after it and reset to that mark at the start
+   of every step so rasters, collision buckets and output staging reuse the
+   same bytes without touching the heap. */
+typedef struct {
+  unsigned char *base;
+  size_t size;
+  size_t used;
+  int mapped;  // 1 if base came from mmap, 0 if malloc
+  int huge;    // ARENA_HUGE_* below: how the region is backed
+} Arena;
+
+enum {
+  ARENA_HUGE_NONE = 0,    // regular pages (or malloc)
+  ARENA_HUGE_ADVISED = 1, // transparent huge pages requested (MADV_HUGEPAGE)
+  ARENA_HUGE_EXPLICIT = 2 // MAP_HUGETLB pages from the reserved pool
+};
+
+/* Reserve size bytes. Returns 1 on success, 0 on failure. */
+int arena_init(Arena *a, size_t size);
+
+/* Bump-allocate n bytes (16-byte aligned). NULL if a is NULL or full. */
+void *arena_alloc(Arena *a, size_t n);
+
+/* Current fill level, to pass to arena_reset later */
+size_t arena_mark(const Arena *a);
+
+/* Drop everything allocated after mark */
+void arena_reset(Arena *a, size_t mark);
+
+/* Return the memory to the system */
+void arena_release(Arena *a);
+
+#endif  // ARENA_H
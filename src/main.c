@@ -1,10 +1,13 @@
 // main.c
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "auth.h"
 #include "nebula.h"
+#include "scenario.h"
+#include "server.h"
 
 /* Default parameters */
 #define DEFAULT_GRID_W 20
@@ -12,6 +15,10 @@
 #define DEFAULT_PARTICLES 20
 #define DEFAULT_STEPS 40
 
+/* Run arena: the particle array plus per-step scratch (display raster,
+   collision buckets, frame staging) for grids up to 80x50 */
+#define RUN_ARENA_SIZE (sizeof(Particle) * MAX_PARTICLES + 64 * 1024)
+
 /* utility: pause until user presses enter */
 static void wait_enter() {
   printf("Press Enter to continue...");
@@ -19,6 +26,28 @@ static void wait_enter() {
   }
 }
 
+/* Ask for an optional scenario file; fall back to random particles.
+   Returns 0 if the file could not be loaded. */
+static int setupParticles(Particle* p, int* count, int grid_w, int grid_h) {
+  char buf[256];
+  printf("Scenario file (.bin or .csv, blank for random): ");
+  if (fgets(buf, sizeof(buf), stdin) == NULL) buf[0] = 0;
+  buf[strcspn(buf, "\r\n")] = 0;
+  if (buf[0] == 0) {
+    initializeParticles(p, *count, grid_w, grid_h);
+    return 1;
+  }
+  int n = loadScenario(buf, p, MAX_PARTICLES, grid_w, grid_h);
+  if (n <= 0) {
+    if (n == 0) printf("Scenario '%s' has no particles.\n", buf);
+    wait_enter();
+    return 0;
+  }
+  printf("Loaded %d particles from %s\n", n, buf);
+  *count = n;
+  return 1;
+}
+
 /* Count alive particles */
 static int aliveCount(Particle* p, int count) {
   int c = 0;
@@ -27,9 +56,16 @@ static int aliveCount(Particle* p, int count) {
   return c;
 }
 
-int main() {
+int main(int argc, char** argv) {
   srand((unsigned int)time(NULL));
-  Particle particles[MAX_PARTICLES];
+
+  /* Daemon mode: NebulaSim --serve [socket_path] [workers] */
+  if (argc > 1 && strcmp(argv[1], "--serve") == 0) {
+    const char* path = (argc > 2) ? argv[2] : SERVER_DEFAULT_SOCKET;
+    int workers = (argc > 3) ? atoi(argv[3]) : SERVER_DEFAULT_WORKERS;
+    return server_run(path, workers);
+  }
+
   int grid_w = DEFAULT_GRID_W;
   int grid_h = DEFAULT_GRID_H;
   int num_particles = DEFAULT_PARTICLES;
@@ -44,6 +80,16 @@ int main() {
   const char* user = auth_get_current_user();
   if (user) printf("Logged in as: %s\n", user);
 
+  /* Particles live for the whole run; everything after step_mark is
+     scratch that is reset at the start of every step */
+  Arena arena;
+  if (!arena_init(&arena, RUN_ARENA_SIZE)) {
+    printf("Out of memory.\n");
+    return 1;
+  }
+  Particle* particles = arena_alloc(&arena, sizeof(Particle) * MAX_PARTICLES);
+  size_t step_mark = arena_mark(&arena);
+
   /* Basic menu */
   while (1) {
     system("clear||cls");
@@ -86,19 +132,28 @@ int main() {
       }
 
       /* init */
-      initializeParticles(particles, num_particles, grid_w, grid_h);
+      if (!setupParticles(particles, &num_particles, grid_w, grid_h)) continue;
       int step = 1;
       while (1) {
+        arena_reset(&arena, step_mark);
         system("clear||cls");
         printf("Step %d  Alive: %d\n", step,
                aliveCount(particles, num_particles));
-        displayGrid(particles, num_particles, grid_w, grid_h);
+        displayGrid(particles, num_particles, grid_w, grid_h, &arena);
         printf(
-            "\nOptions: (Enter) next step | s Save frame | q Quit to menu\n");
+            "\nOptions: (Enter) next step | s Save frame | x Export scenario "
+            "| q Quit to menu\n");
         char cmd = getchar();
         if (cmd == 'q' || cmd == 'Q') break;
-        if (cmd == 's' || cmd == 'S') {
-          if (!saveToFile(particles, num_particles, step, grid_w, grid_h)) {
+        if (cmd == 'x' || cmd == 'X') {
+          if (saveScenarioBinary("scenario.bin", particles, num_particles))
+            printf("Exported current particles to scenario.bin\n");
+          else
+            printf("Failed to export scenario.bin\n");
+          wait_enter();
+        } else if (cmd == 's' || cmd == 'S') {
+          if (!saveToFile(particles, num_particles, step, grid_w, grid_h,
+                          &arena)) {
             printf("Failed to save frame %d\n", step);
             wait_enter();
           } else {
@@ -107,9 +162,8 @@ int main() {
           }
         } else {
           /* proceed normal update */
-          moveParticles(particles, num_particles, grid_w, grid_h);
-          handleCollisions(particles, num_particles, grid_w, grid_h);
-          updateBrightness(particles, num_particles);
+          stepSimulation(particles, num_particles, grid_w, grid_h, NULL,
+                         &arena);
           step++;
         }
         /* consume leftover newline if any */
@@ -140,19 +194,18 @@ int main() {
         if (v > 0 && v <= 10000) steps = v;
       }
 
-      initializeParticles(particles, num_particles, grid_w, grid_h);
+      if (!setupParticles(particles, &num_particles, grid_w, grid_h)) continue;
 
       /* ensure steps folder exists - best-effort */
       system("mkdir -p steps 2> /dev/null || mkdir steps 2> /dev/null");
 
       for (int s = 1; s <= steps; ++s) {
+        arena_reset(&arena, step_mark);
         printf("Running step %d / %d\r", s, steps);
         fflush(stdout);
-        displayGrid(particles, num_particles, grid_w, grid_h);
-        saveToFile(particles, num_particles, s, grid_w, grid_h);
-        moveParticles(particles, num_particles, grid_w, grid_h);
-        handleCollisions(particles, num_particles, grid_w, grid_h);
-        updateBrightness(particles, num_particles);
+        displayGrid(particles, num_particles, grid_w, grid_h, &arena);
+        saveToFile(particles, num_particles, s, grid_w, grid_h, &arena);
+        stepSimulation(particles, num_particles, grid_w, grid_h, NULL, &arena);
         /* reduce console spam slightly */
       }
       printf("\nBatch save complete. Files saved to steps/stepXXXX.txt\n");
@@ -171,12 +224,11 @@ int main() {
       steps = 10;
       initializeParticles(particles, num_particles, grid_w, grid_h);
       for (int s = 1; s <= steps; ++s) {
+        arena_reset(&arena, step_mark);
         system("clear||cls");
         printf("Example run - Step %d / %d\n", s, steps);
-        displayGrid(particles, num_particles, grid_w, grid_h);
-        moveParticles(particles, num_particles, grid_w, grid_h);
-        handleCollisions(particles, num_particles, grid_w, grid_h);
-        updateBrightness(particles, num_particles);
+        displayGrid(particles, num_particles, grid_w, grid_h, &arena);
+        stepSimulation(particles, num_particles, grid_w, grid_h, NULL, &arena);
         printf("\nPress Enter for next step... (or Ctrl+C to exit example)\n");
         getchar();
       }
@@ -184,6 +236,7 @@ int main() {
     }
   }
 
+  arena_release(&arena);
   printf("Exiting NebulaSim. Goodbye!\n");
   return 0;
 }
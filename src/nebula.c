@@ -1,4 +1,5 @@
 // nebula.c  (color-enabled version)
+#define _POSIX_C_SOURCE 200809L
 #include "nebula.h"
 
 #include <stdio.h>
@@ -8,8 +9,14 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
+/* Largest "NebulaSim frame N\ngrid W H\n" header saveToFile writes */
+#define FRAME_HEADER_MAX 64
+
 /* Helper: clamp value between min and max */
 static int clamp(int v, int lo, int hi) {
   if (v < lo) return lo;
@@ -20,6 +27,18 @@ static int clamp(int v, int lo, int hi) {
 /* Random integer from lo to hi inclusive */
 static int rand_range(int lo, int hi) { return lo + (rand() % (hi - lo + 1)); }
 
+/* Portable reentrant generator (the POSIX sample rand); used instead of
+   rand_r so the same seed gives the same run on every platform */
+static int next_rand_r(unsigned int* seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return (int)((*seed / 65536u) % 32768u);
+}
+
+/* Same as rand_range, drawing from a caller-owned seed */
+static int rand_range_r(unsigned int* seed, int lo, int hi) {
+  return lo + (next_rand_r(seed) % (hi - lo + 1));
+}
+
 /* Try to enable ANSI processing on Windows so color codes work */
 static void enable_ansi_on_windows(void) {
 #ifdef _WIN32
@@ -49,20 +68,26 @@ static void print_colored_char(char ch) {
   }
 }
 
+/* Draw from *seed, or from rand() when seed is NULL */
+static int draw_range(unsigned int* seed, int lo, int hi) {
+  return seed ? rand_range_r(seed, lo, hi) : rand_range(lo, hi);
+}
+
 /* Initialize particles: random non-overlapping positions (best-effort),
    random energy between 1 and 5, brightness set by energy */
-void initializeParticles(Particle* p, int count, int grid_w, int grid_h) {
+static void init_particles(Particle* p, int count, int grid_w, int grid_h,
+                           unsigned int* seed) {
   int i, tries;
   for (i = 0; i < count && i < MAX_PARTICLES; ++i) {
     p[i].alive = 1;
-    p[i].energy = rand_range(1, 5);
+    p[i].energy = draw_range(seed, 1, 5);
     p[i].brightness = (p[i].energy >= 4) ? 2 : 1;
     /* try to place in a mostly random empty position (avoid trivial overlaps)
      */
     tries = 0;
     while (tries < 50) {
-      int x = rand_range(0, grid_w - 1);
-      int y = rand_range(0, grid_h - 1);
+      int x = draw_range(seed, 0, grid_w - 1);
+      int y = draw_range(seed, 0, grid_h - 1);
       int occupied = 0;
       for (int j = 0; j < i; ++j) {
         if (p[j].alive && p[j].x == x && p[j].y == y) {
@@ -79,16 +104,41 @@ void initializeParticles(Particle* p, int count, int grid_w, int grid_h) {
     }
     /* if couldn't find unique, just put randomly */
     if (tries >= 50) {
-      p[i].x = rand_range(0, grid_w - 1);
-      p[i].y = rand_range(0, grid_h - 1);
+      p[i].x = draw_range(seed, 0, grid_w - 1);
+      p[i].y = draw_range(seed, 0, grid_h - 1);
     }
   }
   /* mark rest as dead if count < MAX_PARTICLES */
   for (int k = count; k < MAX_PARTICLES; ++k) p[k].alive = 0;
 }
 
+void initializeParticles(Particle* p, int count, int grid_w, int grid_h) {
+  init_particles(p, count, grid_w, grid_h, NULL);
+}
+
+void initializeParticles_r(Particle* p, int count, int grid_w, int grid_h,
+                           unsigned int* seed) {
+  init_particles(p, count, grid_w, grid_h, seed);
+}
+
+/* Rasterize particles into out (grid_h rows of grid_w chars, no newlines)
+   using '.' '*' 'O'. If multiple particles share a cell, the brightest wins. */
+void renderGrid(Particle* p, int count, int grid_w, int grid_h, char* out) {
+  memset(out, '.', (size_t)grid_w * grid_h);
+  for (int i = 0; i < count; ++i) {
+    if (!p[i].alive) continue;
+    int x = clamp(p[i].x, 0, grid_w - 1);
+    int y = clamp(p[i].y, 0, grid_h - 1);
+    char ch = (p[i].brightness >= 2) ? 'O' : '*';
+    /* row-major: y is row */
+    char* cell = &out[y * grid_w + x];
+    if (*cell == '.' || ch == 'O') *cell = ch;
+  }
+}
+
 /* Display the grid to console using '.' '*' 'O' characters, but with colors */
-void displayGrid(Particle* p, int count, int grid_w, int grid_h) {
+void displayGrid(Particle* p, int count, int grid_w, int grid_h,
+                 Arena* scratch) {
   static int ansi_init_done = 0;
   if (!ansi_init_done) {
     enable_ansi_on_windows();
@@ -96,23 +146,12 @@ void displayGrid(Particle* p, int count, int grid_w, int grid_h) {
   }
 
   /* create char grid */
-  char (*grid)[grid_w] = malloc(sizeof(char[grid_h][grid_w]));
+  char (*grid)[grid_w] = arena_alloc(scratch, sizeof(char[grid_h][grid_w]));
   if (!grid) {
     printf("Memory allocation failed for grid display.\n");
     return;
   }
-  for (int r = 0; r < grid_h; ++r)
-    for (int c = 0; c < grid_w; ++c) grid[r][c] = '.';
-
-  /* place particles (if multiple in one cell, show brightest) */
-  for (int i = 0; i < count; ++i) {
-    if (!p[i].alive) continue;
-    int x = clamp(p[i].x, 0, grid_w - 1);
-    int y = clamp(p[i].y, 0, grid_h - 1);
-    char ch = (p[i].brightness >= 2) ? 'O' : '*';
-    /* grid[y][x] because y is row */
-    if (grid[y][x] == '.' || ch == 'O') grid[y][x] = ch;
-  }
+  renderGrid(p, count, grid_w, grid_h, &grid[0][0]);
 
   /* print column header */
   printf("   ");
@@ -129,8 +168,6 @@ void displayGrid(Particle* p, int count, int grid_w, int grid_h) {
     }
     printf("\n");
   }
-
-  free(grid);
 }
 
 /* Move particles randomly by -1,0,+1 in x and y while staying inside grid */
@@ -147,6 +184,20 @@ void moveParticles(Particle* p, int count, int grid_w, int grid_h) {
   }
 }
 
+/* moveParticles with a caller-owned random stream (see nebula.h) */
+void moveParticles_r(Particle* p, int count, int grid_w, int grid_h,
+                     unsigned int* seed) {
+  for (int i = 0; i < count; ++i) {
+    if (!p[i].alive) continue;
+    int dx = rand_range_r(seed, -1, 1);
+    int dy = rand_range_r(seed, -1, 1);
+    p[i].x = clamp(p[i].x + dx, 0, grid_w - 1);
+    p[i].y = clamp(p[i].y + dy, 0, grid_h - 1);
+    if (next_rand_r(seed) % 10 == 0) p[i].energy = p[i].energy - 1;
+    if (p[i].energy < 0) p[i].energy = 0;
+  }
+}
+
 /* If multiple particles share a cell, merge them into one particle:
    - the first alive in that cell accumulates energies
    - others are set alive=0
@@ -165,6 +216,37 @@ void handleCollisions(Particle* p, int count, int grid_w, int grid_h) {
   }
 }
 
+/* Same result as handleCollisions, in one pass: each cell remembers the
+   first alive particle that landed in it and absorbs every later one.
+   Falls back to the pairwise loop if scratch has no room for the buckets
+   or a particle sits off the grid (it has no bucket). */
+void handleCollisionsBucketed(Particle* p, int count, int grid_w, int grid_h,
+                              Arena* scratch) {
+  for (int i = 0; i < count; ++i) {
+    if (p[i].alive && (p[i].x < 0 || p[i].x >= grid_w || p[i].y < 0 ||
+                       p[i].y >= grid_h)) {
+      handleCollisions(p, count, grid_w, grid_h);
+      return;
+    }
+  }
+  int* head = arena_alloc(scratch, sizeof(int) * (size_t)grid_w * grid_h);
+  if (!head) {
+    handleCollisions(p, count, grid_w, grid_h);
+    return;
+  }
+  memset(head, 0xff, sizeof(int) * (size_t)grid_w * grid_h); /* all -1 */
+  for (int i = 0; i < count; ++i) {
+    if (!p[i].alive) continue;
+    int* cell = &head[p[i].y * grid_w + p[i].x];
+    if (*cell < 0) {
+      *cell = i;
+    } else {
+      p[*cell].energy += p[i].energy;
+      p[i].alive = 0;
+    }
+  }
+}
+
 /* Update brightness based on energy values; remove particles with zero energy
  */
 void updateBrightness(Particle* p, int count) {
@@ -182,45 +264,71 @@ void updateBrightness(Particle* p, int count) {
   }
 }
 
+/* One full step: move, merge collisions, update brightness. seed selects
+   the random stream (NULL = rand()); scratch holds the collision buckets. */
+void stepSimulation(Particle* p, int count, int grid_w, int grid_h,
+                    unsigned int* seed, Arena* scratch) {
+  if (seed)
+    moveParticles_r(p, count, grid_w, grid_h, seed);
+  else
+    moveParticles(p, count, grid_w, grid_h);
+  handleCollisionsBucketed(p, count, grid_w, grid_h, scratch);
+  updateBrightness(p, count);
+}
+
+/* Write len bytes to filename in one go, without stdio buffers */
+static int write_whole_file(const char* filename, const char* buf,
+                            size_t len) {
+#ifdef _WIN32
+  FILE* fp = fopen(filename, "wb");
+  if (!fp) return 0;
+  int ok = fwrite(buf, 1, len, fp) == len;
+  if (fclose(fp) != 0) ok = 0;
+  return ok;
+#else
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return 0;
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0) {
+      close(fd);
+      return 0;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+  return close(fd) == 0;
+#endif
+}
+
 /* Save current grid snapshot into steps/step<step>.txt
+   The frame is staged in scratch and written with a single write.
    Returns 1 on success, 0 on failure. */
-int saveToFile(Particle* p, int count, int step, int grid_w, int grid_h) {
+int saveToFile(Particle* p, int count, int step, int grid_w, int grid_h,
+               Arena* scratch) {
   char filename[256];
   snprintf(filename, sizeof(filename), "steps/step%04d.txt", step);
-  FILE* fp = fopen(filename, "w");
-  if (!fp) return 0;
 
-  /* Simple metadata */
-  fprintf(fp, "NebulaSim frame %d\n", step);
-  fprintf(fp, "grid %d %d\n", grid_w, grid_h);
+  size_t cap = FRAME_HEADER_MAX + (size_t)grid_h * (grid_w + 1);
+  char* out = arena_alloc(scratch, cap);
+  char* grid = arena_alloc(scratch, (size_t)grid_w * grid_h);
+  if (!out || !grid) return 0;
 
-  /* create grid representation */
-  char (*grid)[grid_w] = malloc(sizeof(char[grid_h][grid_w]));
-  if (!grid) {
-    fclose(fp);
-    return 0;
-  }
-  for (int r = 0; r < grid_h; ++r)
-    for (int c = 0; c < grid_w; ++c) grid[r][c] = '.';
-  for (int i = 0; i < count; ++i) {
-    if (!p[i].alive) continue;
-    int x = clamp(p[i].x, 0, grid_w - 1);
-    int y = clamp(p[i].y, 0, grid_h - 1);
-    char ch = (p[i].brightness >= 2) ? 'O' : '*';
-    if (grid[y][x] == '.' || ch == 'O') grid[y][x] = ch;
-  }
+  /* Simple metadata */
+  int len = snprintf(out, FRAME_HEADER_MAX, "NebulaSim frame %d\ngrid %d %d\n",
+                     step, grid_w, grid_h);
+  if (len < 0 || len >= FRAME_HEADER_MAX) return 0;
 
-  /* print grid to file */
+  /* grid rows, one line each */
+  renderGrid(p, count, grid_w, grid_h, grid);
+  char* o = out + len;
   for (int r = 0; r < grid_h; ++r) {
-    for (int c = 0; c < grid_w; ++c) {
-      fputc(grid[r][c], fp);
-    }
-    fputc('\n', fp);
+    memcpy(o, grid + (size_t)r * grid_w, (size_t)grid_w);
+    o += grid_w;
+    *o++ = '\n';
   }
 
-  free(grid);
-  fclose(fp);
-  return 1;
+  return write_whole_file(filename, out, (size_t)(o - out));
 }
 
 /* Replay: read files steps/step0001.txt, step0002.txt... until not found.
@@ -2,6 +2,8 @@
 #ifndef NEBULA_H
 #define NEBULA_H
 
+#include "arena.h"
+
 #define MAX_PARTICLES 200
 
 /* Particle structure */
@@ -14,11 +16,32 @@ typedef struct {
 
 /* API functions */
 void initializeParticles(Particle *p, int count, int grid_w, int grid_h);
-void displayGrid(Particle *p, int count, int grid_w, int grid_h);
+void displayGrid(Particle *p, int count, int grid_w, int grid_h,
+                 Arena *scratch);
 void moveParticles(Particle *p, int count, int grid_w, int grid_h);
 void handleCollisions(Particle *p, int count, int grid_w, int grid_h);
 void updateBrightness(Particle *p, int count);
-int saveToFile(Particle *p, int count, int step, int grid_w, int grid_h);
+void renderGrid(Particle *p, int count, int grid_w, int grid_h, char *out);
+int saveToFile(Particle *p, int count, int step, int grid_w, int grid_h,
+               Arena *scratch);
 void replaySimulation();
 
+/* Reentrant variants of initializeParticles and moveParticles for hosts
+   that run several simulations at once (daemon mode). They draw from *seed
+   instead of rand(), so each session keeps its own random stream and a
+   seed gives the same run on every platform. */
+void initializeParticles_r(Particle *p, int count, int grid_w, int grid_h,
+                           unsigned int *seed);
+void moveParticles_r(Particle *p, int count, int grid_w, int grid_h,
+                     unsigned int *seed);
+
+/* Step-loop variants that take their buffers from a run arena (see
+   arena.h) instead of the heap. handleCollisionsBucketed gives the same
+   result as handleCollisions using one bucket per grid cell.
+   stepSimulation = move + collisions + brightness; seed NULL uses rand(). */
+void handleCollisionsBucketed(Particle *p, int count, int grid_w, int grid_h,
+                              Arena *scratch);
+void stepSimulation(Particle *p, int count, int grid_w, int grid_h,
+                    unsigned int *seed, Arena *scratch);
+
 #endif // NEBULA_H
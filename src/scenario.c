@@ -0,0 +1,421 @@
+// scenario.c -- bulk loaders for initial conditions (see scenario.h)
+#define _POSIX_C_SOURCE 200809L
+#include "scenario.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SCENARIO_HEADER_SIZE 12 /* magic[8] + uint32 count */
+#define TEXT_MAX_THREADS 16
+#define TEXT_MIN_CHUNK (1 << 20) /* don't split below 1 MiB per thread */
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+/* ---- whole-file mapping (read into memory on Windows) ---- */
+
+typedef struct {
+  const char* data;
+  size_t size;
+  int mapped; /* 1 if data came from mmap, 0 if malloc */
+} FileView;
+
+static int open_view(const char* path, FileView* v) {
+  v->data = NULL;
+  v->size = 0;
+  v->mapped = 0;
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return 0;
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return 0;
+  }
+  v->size = (size_t)st.st_size;
+  if (v->size > 0) {
+    void* m = mmap(NULL, v->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+      close(fd);
+      return 0;
+    }
+    posix_madvise(m, v->size, POSIX_MADV_SEQUENTIAL);
+    v->data = m;
+    v->mapped = 1;
+  }
+  close(fd); /* the mapping stays valid */
+  return 1;
+#else
+  FILE* fp = fopen(path, "rb");
+  if (!fp) return 0;
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (len < 0) {
+    fclose(fp);
+    return 0;
+  }
+  char* buf = malloc(len > 0 ? (size_t)len : 1);
+  if (!buf || fread(buf, 1, (size_t)len, fp) != (size_t)len) {
+    free(buf);
+    fclose(fp);
+    return 0;
+  }
+  fclose(fp);
+  v->data = buf;
+  v->size = (size_t)len;
+  return 1;
+#endif
+}
+
+static void close_view(FileView* v) {
+#ifndef _WIN32
+  if (v->mapped) munmap((void*)v->data, v->size);
+#endif
+  if (!v->mapped) free((void*)v->data);
+  v->data = NULL;
+}
+
+/* Fill one particle from file values; returns NULL, or why it was
+   rejected */
+static const char* set_particle(Particle* q, long x, long y, long energy,
+                                int grid_w, int grid_h) {
+  if (x < 0 || x >= grid_w || y < 0 || y >= grid_h)
+    return "position outside the grid";
+  if (energy < 0) return "negative energy";
+  if (energy > SCENARIO_MAX_ENERGY)
+    return "energy above " STR(SCENARIO_MAX_ENERGY);
+  q->x = (int)x;
+  q->y = (int)y;
+  q->energy = (int)energy;
+  q->brightness = (energy >= 4) ? 2 : 1;
+  q->alive = 1;
+  return NULL;
+}
+
+static int energy_fits(long long total, const char* path) {
+  if (total <= INT_MAX) return 1;
+  printf("Scenario '%s' total energy %lld is above %d.\n", path, total,
+         INT_MAX);
+  return 0;
+}
+
+static void kill_rest(Particle* p, int from, int capacity) {
+  for (int k = from; k < capacity; ++k) p[k].alive = 0;
+}
+
+/* ---- binary ---- */
+
+int loadScenarioBinary(const char* path, Particle* p, int capacity,
+                       int grid_w, int grid_h) {
+  FileView v;
+  if (!open_view(path, &v)) {
+    printf("Cannot open scenario file '%s'.\n", path);
+    return -1;
+  }
+  if (v.size < SCENARIO_HEADER_SIZE ||
+      memcmp(v.data, SCENARIO_MAGIC, sizeof(SCENARIO_MAGIC)) != 0) {
+    printf("'%s' is not a NebulaSim binary scenario.\n", path);
+    close_view(&v);
+    return -1;
+  }
+  uint32_t count;
+  memcpy(&count, v.data + 8, sizeof(count));
+  if ((v.size - SCENARIO_HEADER_SIZE) / sizeof(ScenarioRecord) != count ||
+      (v.size - SCENARIO_HEADER_SIZE) % sizeof(ScenarioRecord) != 0) {
+    printf("Scenario '%s' is truncated or corrupt.\n", path);
+    close_view(&v);
+    return -1;
+  }
+  if (count > (uint32_t)capacity) {
+    printf("Scenario has %u particles; at most %d supported.\n",
+           (unsigned)count, capacity);
+    close_view(&v);
+    return -1;
+  }
+
+  /* header is 12 bytes, so records stay 4-byte aligned in the mapping */
+  const ScenarioRecord* rec =
+      (const ScenarioRecord*)(v.data + SCENARIO_HEADER_SIZE);
+  long long total = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    const char* why = set_particle(&p[i], rec[i].x, rec[i].y, rec[i].energy,
+                                   grid_w, grid_h);
+    if (why) {
+      printf("Scenario particle %u (%d,%d energy %d): %s (grid %dx%d).\n",
+             (unsigned)i, rec[i].x, rec[i].y, rec[i].energy, why, grid_w,
+             grid_h);
+      close_view(&v);
+      return -1;
+    }
+    total += rec[i].energy;
+  }
+  close_view(&v);
+  if (!energy_fits(total, path)) return -1;
+  kill_rest(p, (int)count, capacity);
+  return (int)count;
+}
+
+int saveScenarioBinary(const char* path, Particle* p, int count) {
+  FILE* fp = fopen(path, "wb");
+  if (!fp) return 0;
+  uint32_t alive = 0;
+  for (int i = 0; i < count; ++i)
+    if (p[i].alive) alive++;
+  char magic[8] = SCENARIO_MAGIC;
+  int ok = fwrite(magic, sizeof(magic), 1, fp) == 1 &&
+           fwrite(&alive, sizeof(alive), 1, fp) == 1;
+  for (int i = 0; ok && i < count; ++i) {
+    if (!p[i].alive) continue;
+    ScenarioRecord r = {p[i].x, p[i].y, p[i].energy};
+    ok = fwrite(&r, sizeof(r), 1, fp) == 1;
+  }
+  if (fclose(fp) != 0) ok = 0;
+  return ok;
+}
+
+/* ---- text ---- */
+
+/* One slice of the file, always starting at a line boundary. Pass 1 counts
+   lines and records; pass 2 parses records into p[first_record...]. */
+typedef struct {
+  const char* begin;
+  const char* end;
+  int lines;
+  int records;
+  int first_line; /* 1-based line number of begin */
+  int first_record;
+  Particle* p;
+  int grid_w, grid_h;
+  const char* header; /* the file's header line, or NULL */
+  long long energy;   /* sum of parsed energies */
+  int err_line;       /* 0 if the chunk parsed cleanly */
+  const char* err_reason;
+} TextChunk;
+
+static const char* skip_blanks(const char* s, const char* end) {
+  while (s < end && (*s == ' ' || *s == '\t')) s++;
+  return s;
+}
+
+/* Blank lines and '#' comments carry no data */
+static int is_ignorable(const char* s, const char* end) {
+  s = skip_blanks(s, end);
+  return s == end || *s == '\r' || *s == '#';
+}
+
+/* A header names the columns ("x,y,energy"); a line with digits in it is
+   a mistyped record such as "O,2,3", not a header */
+static int looks_like_header(const char* s, const char* end) {
+  for (; s < end; ++s)
+    if (*s >= '0' && *s <= '9') return 0;
+  return 1;
+}
+
+/* Every other line is a record and must parse, except the header: the
+   first non-ignorable line of the file, if it has no digits */
+static int is_record(const TextChunk* c, const char* s, const char* end) {
+  return s != c->header && !is_ignorable(s, end);
+}
+
+static const char* line_end(const char* s, const char* end) {
+  const char* nl = memchr(s, '\n', (size_t)(end - s));
+  return nl ? nl : end;
+}
+
+/* Parse one integer; returns pointer past it, or NULL if malformed */
+static const char* parse_long(const char* s, const char* end, long* out) {
+  int neg = 0;
+  if (s < end && (*s == '-' || *s == '+')) neg = (*s++ == '-');
+  if (s >= end || *s < '0' || *s > '9') return NULL;
+  long v = 0;
+  while (s < end && *s >= '0' && *s <= '9') {
+    if (v > (INT_MAX - 9) / 10) return NULL;
+    v = v * 10 + (*s++ - '0');
+  }
+  *out = neg ? -v : v;
+  return s;
+}
+
+static int parse_record(const char* s, const char* end, long* vals) {
+  for (int k = 0; k < 3; ++k) {
+    s = skip_blanks(s, end);
+    if (k > 0 && s < end && *s == ',') s = skip_blanks(s + 1, end);
+    s = parse_long(s, end, &vals[k]);
+    if (!s) return 0;
+  }
+  s = skip_blanks(s, end);
+  if (s < end && *s == '\r') s++;
+  return s == end;
+}
+
+static void* count_chunk(void* arg) {
+  TextChunk* c = arg;
+  for (const char* s = c->begin; s < c->end;) {
+    const char* le = line_end(s, c->end);
+    c->lines++;
+    if (is_record(c, s, le)) c->records++;
+    s = le + 1;
+  }
+  return NULL;
+}
+
+static void* parse_chunk(void* arg) {
+  TextChunk* c = arg;
+  Particle* q = c->p + c->first_record;
+  int line = c->first_line;
+  long v[3];
+  for (const char* s = c->begin; s < c->end; ++line) {
+    const char* le = line_end(s, c->end);
+    if (is_record(c, s, le)) {
+      if (!parse_record(s, le, v)) {
+        c->err_line = line;
+        c->err_reason = "expected x,y,energy";
+        return NULL;
+      }
+      const char* why =
+          set_particle(q++, v[0], v[1], v[2], c->grid_w, c->grid_h);
+      if (why) {
+        c->err_line = line;
+        c->err_reason = why;
+        return NULL;
+      }
+      c->energy += v[2];
+    }
+    s = le + 1;
+  }
+  return NULL;
+}
+
+/* Run fn over every chunk, one thread per chunk where available */
+static void run_chunks(void* (*fn)(void*), TextChunk* chunks, int n) {
+  if (n < 1) return;
+#ifndef _WIN32
+  pthread_t threads[TEXT_MAX_THREADS];
+  int started = 0;
+  for (int i = 1; i < n; ++i) {
+    if (pthread_create(&threads[i], NULL, fn, &chunks[i]) != 0) break;
+    started = i;
+  }
+  fn(&chunks[0]);
+  for (int i = started + 1; i < n; ++i) fn(&chunks[i]); /* create failed */
+  for (int i = 1; i <= started; ++i) pthread_join(threads[i], NULL);
+#else
+  for (int i = 0; i < n; ++i) fn(&chunks[i]);
+#endif
+}
+
+/* Chunk count depends only on the file size, so every machine splits (and
+   numbers lines) the same way; spare threads on small machines just
+   time-share */
+static int pick_threads(size_t size) {
+  size_t n = size / TEXT_MIN_CHUNK + 1;
+  if (n > TEXT_MAX_THREADS) n = TEXT_MAX_THREADS;
+  return (int)n;
+}
+
+int loadScenarioText(const char* path, Particle* p, int capacity, int grid_w,
+                     int grid_h) {
+  FileView v;
+  if (!open_view(path, &v)) {
+    printf("Cannot open scenario file '%s'.\n", path);
+    return -1;
+  }
+  if (v.size == 0) { /* empty file: no particles (the caller reports it) */
+    close_view(&v);
+    kill_rest(p, 0, capacity);
+    return 0;
+  }
+  const char* end = v.data + v.size;
+
+  /* find the optional header before splitting, so chunks agree on it */
+  const char* header = NULL;
+  for (const char* h = v.data; h < end;) {
+    const char* le = line_end(h, end);
+    if (!is_ignorable(h, le)) {
+      if (looks_like_header(h, le)) header = h;
+      break;
+    }
+    h = le + 1;
+  }
+
+  /* split at line boundaries */
+  TextChunk chunks[TEXT_MAX_THREADS];
+  int n = pick_threads(v.size);
+  const char* s = v.data;
+  int used = 0;
+  for (int i = 0; i < n && s < end; ++i) {
+    const char* ce = (i == n - 1) ? end : s + (size_t)(end - s) / (n - i);
+    if (ce < end) ce = line_end(ce, end);
+    if (ce < end) ce++; /* include the newline */
+    memset(&chunks[used], 0, sizeof(TextChunk));
+    chunks[used].begin = s;
+    chunks[used].end = ce;
+    chunks[used].p = p;
+    chunks[used].grid_w = grid_w;
+    chunks[used].grid_h = grid_h;
+    chunks[used].header = header;
+    used++;
+    s = ce;
+  }
+
+  if (used == 0) {
+    close_view(&v);
+    kill_rest(p, 0, capacity);
+    return 0;
+  }
+
+  run_chunks(count_chunk, chunks, used);
+  int total = 0, line = 1;
+  for (int i = 0; i < used; ++i) {
+    chunks[i].first_line = line;
+    chunks[i].first_record = total;
+    line += chunks[i].lines;
+    if (chunks[i].records > capacity - total) {
+      printf("Scenario has more than %d particles.\n", capacity);
+      close_view(&v);
+      return -1;
+    }
+    total += chunks[i].records;
+  }
+
+  run_chunks(parse_chunk, chunks, used);
+  close_view(&v);
+  for (int i = 0; i < used; ++i) {
+    if (chunks[i].err_line) {
+      printf("Scenario '%s' line %d: %s (grid %dx%d).\n", path,
+             chunks[i].err_line, chunks[i].err_reason, grid_w, grid_h);
+      return -1;
+    }
+  }
+  long long energy = 0;
+  for (int i = 0; i < used; ++i) energy += chunks[i].energy;
+  if (!energy_fits(energy, path)) return -1;
+  kill_rest(p, total, capacity);
+  return total;
+}
+
+/* Case-insensitive extension match, so "map.CSV" counts as text */
+static int has_ext(const char* dot, const char* ext) {
+  for (; *dot && *ext; ++dot, ++ext)
+    if (tolower((unsigned char)*dot) != *ext) return 0;
+  return *dot == *ext;
+}
+
+int loadScenario(const char* path, Particle* p, int capacity, int grid_w,
+                 int grid_h) {
+  const char* dot = strrchr(path, '.');
+  if (dot && (has_ext(dot, ".csv") || has_ext(dot, ".txt")))
+    return loadScenarioText(path, p, capacity, grid_w, grid_h);
+  return loadScenarioBinary(path, p, capacity, grid_w, grid_h);
+}
@@ -0,0 +1,51 @@
+// scenario.h -- load initial particle states (x, y, energy) from a file
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <stdint.h>
+
+#include "nebula.h"
+
+/* Binary scenario file:
+     8 bytes   magic "NEBSCN1\0"
+     uint32    particle count
+     count x ScenarioRecord
+   All integers are host byte order (little-endian on supported targets). */
+#define SCENARIO_MAGIC "NEBSCN1"
+
+/* Largest energy a scenario particle may start with. The loaders also
+   reject files whose total energy exceeds INT_MAX, so collision merges
+   (which add energies) can never overflow an int. */
+#define SCENARIO_MAX_ENERGY 1000
+
+typedef struct {
+  int32_t x, y, energy;
+} ScenarioRecord;
+
+/* All loaders fill p[0..n-1] with alive particles (brightness derived from
+   energy as in initializeParticles), mark p[n..capacity-1] dead and return
+   n. On error (missing/corrupt file, more than capacity particles, a
+   position outside grid_w x grid_h, energy outside 0..SCENARIO_MAX_ENERGY,
+   total energy above INT_MAX) they print the reason and return -1. */
+
+/* Binary format above; the file is memory-mapped and copied directly. */
+int loadScenarioBinary(const char *path, Particle *p, int capacity,
+                       int grid_w, int grid_h);
+
+/* Text format: one "x,y,energy" per line (commas or whitespace). Blank
+   lines and '#' comments are skipped, as is the first remaining line if it
+   contains no digits (a header); any other line that does not parse is an
+   error. Large files are parsed in parallel chunks. */
+int loadScenarioText(const char *path, Particle *p, int capacity, int grid_w,
+                     int grid_h);
+
+/* Pick the loader by extension (any case): .csv / .txt -> text, otherwise
+   binary. */
+int loadScenario(const char *path, Particle *p, int capacity, int grid_w,
+                 int grid_h);
+
+/* Write p[0..count-1] (alive particles only) as a binary scenario.
+   Returns 1 on success, 0 on failure. */
+int saveScenarioBinary(const char *path, Particle *p, int count);
+
+#endif  // SCENARIO_H
@@ -0,0 +1,576 @@
+// server.c -- daemon mode: one event loop accepts clients on a Unix domain
+// socket and hands complete requests to a pool of worker threads that own
+// the simulation stepping. See server.h for the wire protocol.
+#define _POSIX_C_SOURCE 200809L
+#include "server.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+
+int server_run(const char* socket_path, int workers) {
+  (void)socket_path;
+  (void)workers;
+  printf("Daemon mode needs Unix domain sockets (not available on Windows).\n");
+  return 1;
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nebula.h"
+
+/* One independent simulation. `lock` is held for the whole of a request so
+   a session is only ever stepped by one worker at a time.
+
+   in_use and id change only while holding both `lock` and sessions_lock
+   (always in that order), so either lock is enough to read them.
+   sessions_lock is never held while waiting for a session's lock: a long
+   STEP on one session must not stall lookups or CREATE for the others. */
+typedef struct {
+  int in_use;
+  int reserved;  // picked by a CREATE that is still filling it in
+  uint32_t id;
+  pthread_mutex_t lock;
+  Particle particles[MAX_PARTICLES];
+  int count, grid_w, grid_h;
+  unsigned int seed;  // per-session random stream for moveParticles_r
+  uint32_t step;
+} Session;
+
+/* Largest reply: header plus a full 80x50 frame */
+#define REPLY_MAX (sizeof(ServerReplyHeader) + 80 * 50)
+
+/* One connected client. Only the event loop touches these fields; while
+   `busy` is set the client is owned by a worker. A worker sends what the
+   socket takes without waiting; any unsent tail stays in `out` for the
+   event loop to flush on POLLOUT, and no new request is read until it is
+   gone. */
+typedef struct {
+  int fd;  // -1 when the slot is free
+  int busy;
+  size_t have;  // bytes of req received so far
+  ServerRequest req;
+  unsigned char out[REPLY_MAX];
+  size_t out_len, out_sent;
+  long out_deadline;  // now_ms() by which the reply must be delivered
+} Client;
+
+static Session sessions[SERVER_MAX_SESSIONS];
+static uint32_t next_generation = 0;
+static pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Client clients[SERVER_MAX_CLIENTS];
+/* Spare descriptor for shedding connections when out of fds (see
+   shed_connection); while accept_paused the listener is not polled. */
+static int reserve_fd = -1;
+static int accept_paused = 0;
+
+/* Work queue: indices into clients[]. Each client has at most one request
+   in flight, so SERVER_MAX_CLIENTS entries are always enough. */
+static int queue[SERVER_MAX_CLIENTS];
+static int queue_head = 0, queue_len = 0;
+static int queue_stop = 0;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+/* Self-pipe: workers post finished client indices, the signal handler
+   posts a wake-up, the event loop reads them. */
+static int wake_pipe[2] = {-1, -1};
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int sig) {
+  (void)sig;
+  int saved = errno;
+  int token = -1;
+  stop_requested = 1;
+  if (write(wake_pipe[1], &token, sizeof(token)) < 0) { /* best-effort */
+  }
+  errno = saved;
+}
+
+/* ---- sessions ---- */
+
+static void sessions_init(void) {
+  for (int i = 0; i < SERVER_MAX_SESSIONS; ++i) {
+    sessions[i].in_use = 0;
+    sessions[i].reserved = 0;
+    pthread_mutex_init(&sessions[i].lock, NULL);
+  }
+}
+
+/* Find and lock a live session; returns NULL if id is unknown. Only the
+   session's own lock is waited on; the id is checked again once it is held
+   because the session may have been destroyed (or its slot reused) while
+   we waited. */
+static Session* session_acquire(uint32_t id) {
+  if (id == 0) return NULL;
+  Session* s = &sessions[(id - 1) % SERVER_MAX_SESSIONS];
+  pthread_mutex_lock(&sessions_lock);
+  int live = s->in_use && s->id == id;
+  pthread_mutex_unlock(&sessions_lock);
+  if (!live) return NULL;
+
+  pthread_mutex_lock(&s->lock);
+  if (!s->in_use || s->id != id) {
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+  }
+  return s;
+}
+
+static void session_stats(const Session* s, ServerStats* st) {
+  memset(st, 0, sizeof(*st));
+  st->step = s->step;
+  st->grid_w = (uint32_t)s->grid_w;
+  st->grid_h = (uint32_t)s->grid_h;
+  for (int i = 0; i < s->count; ++i) {
+    if (!s->particles[i].alive) continue;
+    st->alive++;
+    if (s->particles[i].brightness >= 2) st->bright++;
+    st->total_energy += (uint32_t)s->particles[i].energy;
+  }
+}
+
+/* ---- request handling (runs on workers) ---- */
+
+/* Fill payload for one request; returns SRV_OK or an error status and sets
+   *len to the payload size. payload holds at least 80 * 50 bytes; scratch
+   is the worker's arena for per-step buffers. */
+static uint32_t handle_request(const ServerRequest* rq, unsigned char* payload,
+                               uint32_t* len, Arena* scratch) {
+  *len = 0;
+  if (rq->op == SRV_OP_CREATE) {
+    int w = (int)rq->args[0], h = (int)rq->args[1], n = (int)rq->args[2];
+    if (rq->args[0] > 80 || rq->args[1] > 50 || rq->args[2] > MAX_PARTICLES ||
+        w <= 4 || h <= 4 || n <= 0)
+      return SRV_ERR_BAD_ARGS;
+
+    /* reserve a free slot, then take its lock in the usual order */
+    pthread_mutex_lock(&sessions_lock);
+    int slot = -1;
+    for (int i = 0; i < SERVER_MAX_SESSIONS; ++i) {
+      if (!sessions[i].in_use && !sessions[i].reserved) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot >= 0) sessions[slot].reserved = 1;
+    pthread_mutex_unlock(&sessions_lock);
+    if (slot < 0) return SRV_ERR_FULL;
+
+    Session* s = &sessions[slot];
+    pthread_mutex_lock(&s->lock);
+    pthread_mutex_lock(&sessions_lock);
+    /* id encodes the slot; the generation keeps stale ids from matching */
+    s->id = (uint32_t)slot + 1 +
+            SERVER_MAX_SESSIONS * (next_generation++ % 4096);
+    s->in_use = 1;
+    s->reserved = 0;
+    pthread_mutex_unlock(&sessions_lock);
+
+    s->grid_w = w;
+    s->grid_h = h;
+    s->count = n;
+    s->seed = rq->args[3];
+    s->step = 0;
+    initializeParticles_r(s->particles, n, w, h, &s->seed);
+
+    uint32_t id = s->id;
+    pthread_mutex_unlock(&s->lock);
+    memcpy(payload, &id, sizeof(id));
+    *len = sizeof(id);
+    return SRV_OK;
+  }
+
+  if (rq->op < SRV_OP_STEP || rq->op > SRV_OP_DESTROY) return SRV_ERR_BAD_OP;
+  if (rq->op == SRV_OP_STEP && rq->args[0] > SERVER_MAX_STEPS_PER_REQ)
+    return SRV_ERR_BAD_ARGS;
+
+  Session* s = session_acquire(rq->session);
+  if (!s) return SRV_ERR_NO_SESSION;
+
+  if (rq->op == SRV_OP_DESTROY) {
+    pthread_mutex_lock(&sessions_lock);
+    s->in_use = 0;
+    pthread_mutex_unlock(&sessions_lock);
+    pthread_mutex_unlock(&s->lock);
+    return SRV_OK;
+  }
+
+  ServerStats st;
+  switch (rq->op) {
+    case SRV_OP_STEP:
+      for (uint32_t k = 0; k < rq->args[0]; ++k) {
+        arena_reset(scratch, 0);
+        stepSimulation(s->particles, s->count, s->grid_w, s->grid_h, &s->seed,
+                       scratch);
+        s->step++;
+      }
+      /* STEP replies with the new stats */
+      session_stats(s, &st);
+      memcpy(payload, &st, sizeof(st));
+      *len = sizeof(st);
+      break;
+    case SRV_OP_STATS:
+      session_stats(s, &st);
+      memcpy(payload, &st, sizeof(st));
+      *len = sizeof(st);
+      break;
+    case SRV_OP_FRAME:
+      renderGrid(s->particles, s->count, s->grid_w, s->grid_h,
+                 (char*)payload);
+      *len = (uint32_t)(s->grid_w * s->grid_h);
+      break;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return SRV_OK;
+}
+
+static long now_ms(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (long)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+/* Send as much of the pending reply as the socket takes right now.
+   Returns 0 if the client is gone, 1 otherwise (the reply may still have
+   an unsent tail). Never blocks. */
+static int flush_reply(Client* c) {
+  while (c->out_sent < c->out_len) {
+    ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent,
+                     MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    c->out_sent += (size_t)n;
+  }
+  return 1;
+}
+
+static int has_pending_reply(const Client* c) {
+  return c->out_sent < c->out_len;
+}
+
+static void* worker_main(void* arg) {
+  (void)arg;
+  /* collision buckets for the largest grid; if this fails the step falls
+     back to the pairwise collision loop */
+  Arena scratch;
+  if (!arena_init(&scratch, 64 * 1024)) scratch.base = NULL;
+  while (1) {
+    pthread_mutex_lock(&queue_lock);
+    while (queue_len == 0 && !queue_stop)
+      pthread_cond_wait(&queue_cond, &queue_lock);
+    if (queue_len == 0) { /* stopping and drained */
+      pthread_mutex_unlock(&queue_lock);
+      if (scratch.base) arena_release(&scratch);
+      return NULL;
+    }
+    int ci = queue[queue_head];
+    queue_head = (queue_head + 1) % SERVER_MAX_CLIENTS;
+    queue_len--;
+    pthread_mutex_unlock(&queue_lock);
+
+    Client* c = &clients[ci];
+    ServerReplyHeader hdr;
+    hdr.status =
+        handle_request(&c->req, c->out + sizeof(hdr), &hdr.length, &scratch);
+    memcpy(c->out, &hdr, sizeof(hdr));
+    c->out_len = sizeof(hdr) + hdr.length;
+    c->out_sent = 0;
+    c->out_deadline = now_ms() + SERVER_SEND_TIMEOUT_MS;
+    int ok = flush_reply(c);
+
+    /* hand the client back (the loop sends any unsent tail); a negative
+       token asks the loop to close it */
+    int token = ok ? ci : -(ci + 2);
+    if (write(wake_pipe[1], &token, sizeof(token)) < 0) {
+      perror("write wake pipe");
+    }
+  }
+}
+
+static void enqueue(int ci) {
+  pthread_mutex_lock(&queue_lock);
+  queue[(queue_head + queue_len) % SERVER_MAX_CLIENTS] = ci;
+  queue_len++;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+/* ---- event loop ---- */
+
+static void close_client(Client* c) {
+  close(c->fd);
+  accept_paused = 0; /* a descriptor is free again */
+  c->fd = -1;
+  c->busy = 0;
+  c->have = 0;
+  c->out_len = c->out_sent = 0;
+}
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+/* Make path free to bind. Only a stale socket (one nobody is listening on)
+   is removed; a live daemon or any other kind of file is left alone. */
+static int clear_stale_socket(const struct sockaddr_un* addr) {
+  const char* path = addr->sun_path;
+  struct stat st;
+  if (lstat(path, &st) < 0) {
+    if (errno == ENOENT) return 1;
+    perror(path);
+    return 0;
+  }
+  if (!S_ISSOCK(st.st_mode)) {
+    printf("%s exists and is not a socket; not replacing it.\n", path);
+    return 0;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return 0;
+  }
+  int rc = connect(fd, (const struct sockaddr*)addr, sizeof(*addr));
+  int err = errno;
+  close(fd);
+  if (rc == 0) {
+    printf("A daemon is already listening on %s.\n", path);
+    return 0;
+  }
+  if (err != ECONNREFUSED) {
+    errno = err;
+    perror(path);
+    return 0;
+  }
+  if (unlink(path) < 0 && errno != ENOENT) {
+    perror(path);
+    return 0;
+  }
+  return 1;
+}
+
+static int open_listener(const char* path) {
+  struct sockaddr_un addr;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    printf("Socket path too long: %s\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (!clear_stale_socket(&addr)) return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+      listen(fd, 64) < 0 || !set_nonblocking(fd)) {
+    perror("bind/listen");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Out of descriptors, a pending connection stays queued and the listener
+   stays readable, so poll() would return at once forever. Give up the
+   spare fd, accept and drop the connection, then take the spare back; if
+   that fails, stop polling the listener until a client closes. */
+static void shed_connection(int lfd) {
+  if (reserve_fd >= 0) {
+    close(reserve_fd);
+    int fd = accept(lfd, NULL, NULL);
+    if (fd >= 0) close(fd);
+    reserve_fd = open("/dev/null", O_RDONLY);
+  }
+  if (reserve_fd < 0) accept_paused = 1;
+}
+
+static void accept_clients(int lfd) {
+  while (1) {
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno == EMFILE || errno == ENFILE) {
+        printf("Out of file descriptors; dropping a connection.\n");
+        shed_connection(lfd);
+      }
+      return; /* EAGAIN: nothing more pending */
+    }
+    int slot = -1;
+    for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) {
+      if (clients[i].fd < 0) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot < 0 || !set_nonblocking(fd)) {
+      close(fd); /* too many clients */
+      continue;
+    }
+    clients[slot].fd = fd;
+    clients[slot].busy = 0;
+    clients[slot].have = 0;
+    clients[slot].out_len = clients[slot].out_sent = 0;
+  }
+}
+
+/* Read what is available; queue the request once it is complete */
+static void read_client(int ci) {
+  Client* c = &clients[ci];
+  ssize_t n = recv(c->fd, (char*)&c->req + c->have,
+                   sizeof(c->req) - c->have, 0);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                 errno != EINTR)) {
+    close_client(c);
+    return;
+  }
+  if (n < 0) return;
+  c->have += (size_t)n;
+  if (c->have == sizeof(c->req)) {
+    c->have = 0;
+    c->busy = 1;
+    enqueue(ci);
+  }
+}
+
+/* Socket writable again: send more of the reply tail */
+static void write_client(int ci) {
+  if (!flush_reply(&clients[ci])) close_client(&clients[ci]);
+}
+
+/* Close clients whose reply has not gone out in time; returns the poll()
+   timeout until the next deadline, or -1 if none is pending. */
+static int expire_replies(void) {
+  long now = now_ms(), next = -1;
+  for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) {
+    Client* c = &clients[i];
+    if (c->fd < 0 || c->busy || !has_pending_reply(c)) continue;
+    if (c->out_deadline <= now) {
+      close_client(c); /* stopped reading its replies */
+      continue;
+    }
+    if (next < 0 || c->out_deadline - now < next) next = c->out_deadline - now;
+  }
+  return (int)next;
+}
+
+static void drain_wake_pipe(void) {
+  int token;
+  while (read(wake_pipe[0], &token, sizeof(token)) == sizeof(token)) {
+    if (token >= 0) {
+      clients[token].busy = 0;
+    } else if (token <= -2) {
+      close_client(&clients[-token - 2]);
+    }
+  }
+}
+
+int server_run(const char* socket_path, int workers) {
+  if (workers < 1) workers = 1;
+  if (workers > SERVER_MAX_WORKERS) workers = SERVER_MAX_WORKERS;
+
+  if (pipe(wake_pipe) < 0 || !set_nonblocking(wake_pipe[0]) ||
+      !set_nonblocking(wake_pipe[1])) {
+    perror("pipe");
+    return 1;
+  }
+  int lfd = open_listener(socket_path);
+  if (lfd < 0) {
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    return 1;
+  }
+
+  sessions_init();
+  for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) clients[i].fd = -1;
+  reserve_fd = open("/dev/null", O_RDONLY);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_t threads[SERVER_MAX_WORKERS];
+  int started = 0;
+  for (; started < workers; ++started) {
+    if (pthread_create(&threads[started], NULL, worker_main, NULL) != 0) break;
+  }
+  printf("NebulaSim daemon listening on %s (%d workers)\n", socket_path,
+         started);
+  fflush(stdout);
+
+  struct pollfd pfds[SERVER_MAX_CLIENTS + 2];
+  int owner[SERVER_MAX_CLIENTS + 2];
+  while (!stop_requested && started > 0) {
+    int n = 0;
+    pfds[n].fd = accept_paused ? -1 : lfd; /* poll() skips negative fds */
+    pfds[n].events = POLLIN;
+    owner[n++] = -1;
+    pfds[n].fd = wake_pipe[0];
+    pfds[n].events = POLLIN;
+    owner[n++] = -1;
+    int timeout = expire_replies();
+    for (int i = 0; i < SERVER_MAX_CLIENTS; ++i) {
+      if (clients[i].fd < 0 || clients[i].busy) continue;
+      pfds[n].fd = clients[i].fd;
+      pfds[n].events = has_pending_reply(&clients[i]) ? POLLOUT : POLLIN;
+      owner[n++] = i;
+    }
+
+    if (poll(pfds, (nfds_t)n, timeout) < 0) {
+      if (errno == EINTR) continue;
+      perror("poll");
+      break;
+    }
+    if (pfds[1].revents) drain_wake_pipe();
+    if (pfds[0].revents) accept_clients(lfd);
+    for (int k = 2; k < n; ++k) {
+      if (!pfds[k].revents) continue;
+      if (pfds[k].events == POLLOUT)
+        write_client(owner[k]);
+      else
+        read_client(owner[k]);
+    }
+  }
+
+  /* stop workers once the queued requests are answered; unsent reply
+     tails are dropped with their clients */
+  pthread_mutex_lock(&queue_lock);
+  queue_stop = 1;
+  pthread_cond_broadcast(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+  for (int i = 0; i < started; ++i) pthread_join(threads[i], NULL);
+
+  for (int i = 0; i < SERVER_MAX_CLIENTS; ++i)
+    if (clients[i].fd >= 0) close_client(&clients[i]);
+  close(lfd);
+  if (reserve_fd >= 0) close(reserve_fd);
+  unlink(socket_path);
+  close(wake_pipe[0]);
+  close(wake_pipe[1]);
+  printf("NebulaSim daemon stopped.\n");
+  return started > 0 ? 0 : 1;
+}
+
+#endif  // _WIN32
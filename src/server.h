@@ -0,0 +1,69 @@
+// server.h -- daemon mode: many simulation sessions behind one Unix socket
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#define SERVER_DEFAULT_SOCKET "/tmp/nebulasim.sock"
+#define SERVER_DEFAULT_WORKERS 4
+#define SERVER_MAX_WORKERS 64
+#define SERVER_MAX_SESSIONS 1024
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_MAX_STEPS_PER_REQ 10000
+/* A reply that cannot be delivered within this long closes the client */
+#define SERVER_SEND_TIMEOUT_MS 5000
+
+/* Binary protocol (native byte order, local socket only).
+
+   Every request is one fixed-size ServerRequest. Every reply is a
+   ServerReplyHeader followed by `length` payload bytes.
+
+     op                 args                         payload on success
+     SRV_OP_CREATE      w, h, particles, seed        uint32 session id
+     SRV_OP_STEP        n                            ServerStats
+     SRV_OP_FRAME       -                            grid_h*grid_w chars
+     SRV_OP_STATS       -                            ServerStats
+     SRV_OP_DESTROY     -                            (none)
+
+   Grid and particle limits match the interactive menu (w 5..80,
+   h 5..50, particles 1..MAX_PARTICLES). */
+enum {
+  SRV_OP_CREATE = 1,
+  SRV_OP_STEP = 2,
+  SRV_OP_FRAME = 3,
+  SRV_OP_STATS = 4,
+  SRV_OP_DESTROY = 5
+};
+
+enum {
+  SRV_OK = 0,
+  SRV_ERR_BAD_OP = 1,
+  SRV_ERR_BAD_ARGS = 2,
+  SRV_ERR_NO_SESSION = 3,
+  SRV_ERR_FULL = 4
+};
+
+typedef struct {
+  uint32_t op;
+  uint32_t session;  // ignored for SRV_OP_CREATE
+  uint32_t args[4];
+} ServerRequest;
+
+typedef struct {
+  uint32_t status;  // SRV_OK or SRV_ERR_*
+  uint32_t length;  // payload bytes that follow
+} ServerReplyHeader;
+
+typedef struct {
+  uint32_t step;  // steps taken since creation
+  uint32_t alive;
+  uint32_t bright;  // alive particles with brightness >= 2
+  uint32_t total_energy;
+  uint32_t grid_w, grid_h;
+} ServerStats;
+
+/* Run the daemon on socket_path with `workers` stepping threads.
+   Blocks until SIGINT/SIGTERM. Returns 0 on clean shutdown, 1 on error. */
+int server_run(const char* socket_path, int workers);
+
+#endif  // SERVER_H